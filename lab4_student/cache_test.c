@@ -1,32 +1,772 @@
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
-#define ARRAY_SIZE (1 << 30)                                    // test array size is 2^28
+#include <sys/utsname.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#define CACHE_LINE_SIZE 64                                      // flush/walk granularity
+#define EVICT_DEFAULT_LLC (8ul << 20)                           // fallback when LLC size is unknown
+#define EVICT_MAX_SIZE (64ul << 20)                             // cap eviction buffer for small containers
+#define PROBE_TRIALS 32                                         // trials per policy probe point
+#define PROBE_MAX_SIZE (128ul << 20)                            // largest buffer a policy probe may map
+#define TRACE_SEED 1                                            // rand() seed shared by tests and simulator replay
 
 typedef unsigned char BYTE;										// define BYTE as one-byte type
 
-BYTE array[ARRAY_SIZE];											// test array
 const int L2_cache_size = 1 << 18;
 
 const int test_time = 1 << 16;
 
+// 驱逐缓冲区（上限为两倍 LLC，按实际遍历的大小延迟分配并预取页）
+BYTE* evict_buffer = NULL;
+unsigned long evict_size = 0;
+unsigned long evict_mapped = 0;
+unsigned long evict_way_stride = 0;                             // LLC 中同一组相邻两路的地址间隔（大小 / 路数）
+int has_clflushopt = 0;
+volatile BYTE evict_sink;
+
 double get_usec(const struct timeval tp0, const struct timeval tp1)
 {
     return 1000000 * (tp1.tv_sec - tp0.tv_sec) + tp1.tv_usec - tp0.tv_usec;
 }
 
+// mmap an anonymous region prefaulted with MAP_POPULATE so that page faults stay out of the test segments
+BYTE* Alloc_Buffer(unsigned long size)
+{
+    BYTE* buffer = (BYTE*) mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (buffer == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return buffer;
+}
+
+void Free_Buffer(BYTE* buffer, unsigned long size)
+{
+    munmap(buffer, size);
+}
+
+// 读取最后一级 Cache 的大小，失败时返回 0
+unsigned long Detect_LLC_Size()
+{
+    long size = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0)
+        size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (size <= 0) {
+        // sysfs 中编号最大的 index 即为 LLC
+        char path[64];
+        for (int index = 0; index < 8; index++) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+            FILE* fp = fopen(path, "r");
+            if (fp == NULL)
+                break;
+            long kb;
+            if (fscanf(fp, "%ldK", &kb) == 1)
+                size = kb << 10;
+            fclose(fp);
+        }
+    }
+    return size > 0 ? (unsigned long) size : 0;
+}
+
+// 初始化驱逐子系统：检测 clflushopt，确定驱逐缓冲区大小（两倍 LLC），缓冲区在首次遍历时才分配
+void Evict_Init()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        has_clflushopt = (ebx >> 23) & 1;
+#endif
+    unsigned long llc_size = Detect_LLC_Size();
+    if (llc_size == 0)
+        llc_size = EVICT_DEFAULT_LLC;
+    long llc_assoc = 0;
+#ifdef _SC_LEVEL3_CACHE_ASSOC
+    llc_assoc = sysconf(_SC_LEVEL3_CACHE_ASSOC);
+#endif
+    evict_way_stride = llc_size / (llc_assoc > 0 ? llc_assoc : 16);
+    evict_size = llc_size << 1;
+    if (evict_size > EVICT_MAX_SIZE) {
+        evict_size = EVICT_MAX_SIZE;
+#if !defined(__x86_64__) && !defined(__i386__) && !defined(__aarch64__)
+        // 没有 clflush 时 Evict_Range 只能靠遍历驱逐，缓冲区封顶后无法挤出整个 LLC
+        printf("warning: LLC of %lu KB exceeds the %lu KB eviction buffer, Evict_Range cannot fully flush the LLC\n",
+               llc_size >> 10, EVICT_MAX_SIZE >> 10);
+#endif
+    }
+}
+
+// 保证驱逐缓冲区至少映射了 size 字节（不超过 evict_size），返回实际可用大小
+unsigned long Evict_Map(unsigned long size)
+{
+    if (size > evict_size)
+        size = evict_size;
+    if (evict_mapped < size) {
+        if (evict_buffer != NULL)
+            Free_Buffer(evict_buffer, evict_mapped);
+        evict_buffer = Alloc_Buffer(size);
+        evict_mapped = size;
+    }
+    return size;
+}
+
+// 每条 Cache 行读一次，用冲突集挤出之前的数据
+void Evict_Walk(unsigned long size)
+{
+    size = Evict_Map(size);
+    BYTE sum = 0;
+    for (unsigned long i = 0; i < size; i += CACHE_LINE_SIZE)
+        sum += evict_buffer[i];
+    evict_sink = sum;
+}
+
+// 只遍历驱逐缓冲区中与 [p, p + size) 在 LLC 中同组的行（地址对路间隔同余）。
+// 按虚拟地址计算，物理索引的 LLC 上是近似；区域不小于路间隔时退化为整体遍历
+void Evict_Walk_Conflicts(const void* p, unsigned long size)
+{
+    if (evict_way_stride == 0 || size >= evict_way_stride) {
+        Evict_Walk(evict_size);
+        return;
+    }
+    unsigned long mapped = Evict_Map(evict_size);
+    unsigned long start = ((unsigned long) p % evict_way_stride) & ~(CACHE_LINE_SIZE - 1ul);
+    BYTE sum = 0;
+    for (unsigned long way = 0; way + evict_way_stride <= mapped; way += evict_way_stride)
+        for (unsigned long i = 0; i < size + CACHE_LINE_SIZE; i += CACHE_LINE_SIZE)
+            sum += evict_buffer[way + (start + i) % evict_way_stride];
+    evict_sink = sum;
+}
+
+// 将 [p, p + size) 逐行刷出所有 Cache 层级：x86 用 clflush(opt)，aarch64 用 dc civac，其他平台退化为冲突集遍历
+void Evict_Range(const void* p, unsigned long size)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    const BYTE* line = (const BYTE*) ((unsigned long) p & ~(CACHE_LINE_SIZE - 1ul));
+    const BYTE* end = (const BYTE*) p + size;
+    if (has_clflushopt) {
+        for (; line < end; line += CACHE_LINE_SIZE)
+            __asm__ volatile(".byte 0x66; clflush %0" : "+m" (*(volatile BYTE*) line));
+    } else {
+        for (; line < end; line += CACHE_LINE_SIZE)
+            __asm__ volatile("clflush %0" : "+m" (*(volatile BYTE*) line));
+    }
+    __asm__ volatile("mfence" ::: "memory");
+#elif defined(__aarch64__)
+    // Linux 允许用户态执行 dc civac（SCTLR_EL1.UCI）
+    const BYTE* line = (const BYTE*) ((unsigned long) p & ~(CACHE_LINE_SIZE - 1ul));
+    const BYTE* end = (const BYTE*) p + size;
+    for (; line < end; line += CACHE_LINE_SIZE)
+        __asm__ volatile("dc civac, %0" :: "r" (line) : "memory");
+    __asm__ volatile("dsb ish" ::: "memory");
+#else
+    Evict_Walk_Conflicts(p, size);
+#endif
+}
+
+// 周期级计时器：x86 上使用 rdtscp，其他平台退化为纳秒时钟
+static inline unsigned long long get_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int aux;
+    return __rdtscp(&aux);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// 对单次读操作计时
+static inline unsigned long long Time_Load(const BYTE* p)
+{
+    unsigned long long t0 = get_cycles();
+    evict_sink = *(volatile const BYTE*) p;
+    unsigned long long t1 = get_cycles();
+    return t1 - t0;
+}
+
+int Compare_Double(const void* a, const void* b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// 求中位数（会对 values 原地排序）
+double Median(double* values, int n)
+{
+    qsort(values, n, sizeof(double), Compare_Double);
+    return (n & 1) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+// 把 [0, 1] 的置信分数转换为等级
+const char* Confidence_Level(double score)
+{
+    if (score >= 0.8)
+        return "high";
+    if (score >= 0.5)
+        return "medium";
+    return "low";
+}
+
+// 读取 L1 DCache 的几何参数，读取失败时使用常见的 32KB / 8 路 / 64B
+void Detect_L1_Geometry(unsigned long* size, unsigned long* assoc, unsigned long* line)
+{
+    long s = 0, a = 0, l = 0;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    s = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    a = sysconf(_SC_LEVEL1_DCACHE_ASSOC);
+    l = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+#endif
+    *size = s > 0 ? (unsigned long) s : 1ul << 15;
+    *assoc = a > 0 ? (unsigned long) a : 8;
+    *line = l > 0 ? (unsigned long) l : CACHE_LINE_SIZE;
+}
+
+// 结构化结果：每个测试点按 (test, point) 累积各次重复的样本，结束时统计并输出 JSON/CSV
+#define MAX_RESULTS 1024
+#define MAX_REPEATS 64
+#define OUTLIER_MAD_SCALE 3.0                                   // |x - median| > 3 * 1.4826 * MAD 视为离群
+#define COMPARE_MIN_CHANGE 0.05                                 // 相对变化低于 5% 不报告
+#define COMPARE_MIN_SAMPLES 5                                   // 比较时每侧至少保留的样本数，少于 5 对 5 时秩检验 |z| 达不到 COMPARE_Z
+#define COMPARE_Z 2.576                                         // 双侧 p < 0.01 的临界值
+
+struct result {
+    char test[32];
+    char point[48];
+    char unit[16];
+    double samples[MAX_REPEATS];
+    int n;
+    // 以下由 Result_Stats 计算
+    int kept;
+    double median, min, mean, stddev;
+};
+
+struct result results[MAX_RESULTS];
+int result_count = 0;
+int current_repeat = 0;
+const char* last_test = "";                                     // 供 Perf_Print 追加计数器结果
+char last_point[48];
+
+// 记录一个测试点本次重复的测量值
+void Record_Result(const char* test, const char* unit, double value, const char* point_fmt, ...)
+{
+    char point[48];
+    va_list args;
+    va_start(args, point_fmt);
+    vsnprintf(point, sizeof(point), point_fmt, args);
+    va_end(args);
+    last_test = test;
+    snprintf(last_point, sizeof(last_point), "%s", point);
+
+    struct result* r = NULL;
+    for (int i = 0; i < result_count; i++) {
+        if (strcmp(results[i].test, test) == 0 && strcmp(results[i].point, point) == 0) {
+            r = &results[i];
+            break;
+        }
+    }
+    if (r == NULL) {
+        if (result_count == MAX_RESULTS)
+            return;
+        r = &results[result_count++];
+        memset(r, 0, sizeof(*r));
+        snprintf(r->test, sizeof(r->test), "%s", test);
+        snprintf(r->point, sizeof(r->point), "%s", point);
+        snprintf(r->unit, sizeof(r->unit), "%s", unit);
+    }
+    if (r->n < MAX_REPEATS)
+        r->samples[r->n++] = value;
+}
+
+// 剔除 MAD 离群点后计算中位数、最小值、均值与标准差
+void Result_Stats(struct result* r)
+{
+    double sorted[MAX_REPEATS], deviation[MAX_REPEATS];
+    memcpy(sorted, r->samples, r->n * sizeof(double));
+    double median = Median(sorted, r->n);
+    for (int i = 0; i < r->n; i++)
+        deviation[i] = r->samples[i] > median ? r->samples[i] - median : median - r->samples[i];
+    double limit = OUTLIER_MAD_SCALE * 1.4826 * Median(deviation, r->n);
+
+    double kept[MAX_REPEATS];
+    r->kept = 0;
+    for (int i = 0; i < r->n; i++) {
+        double d = r->samples[i] > median ? r->samples[i] - median : median - r->samples[i];
+        if (limit == 0 || d <= limit)
+            kept[r->kept++] = r->samples[i];
+    }
+    double sum = 0, square = 0;
+    r->min = kept[0];
+    for (int i = 0; i < r->kept; i++) {
+        sum += kept[i];
+        if (kept[i] < r->min)
+            r->min = kept[i];
+    }
+    r->mean = sum / r->kept;
+    for (int i = 0; i < r->kept; i++)
+        square += (kept[i] - r->mean) * (kept[i] - r->mean);
+    r->stddev = r->kept > 1 ? sqrt(square / (r->kept - 1)) : 0;
+    r->median = Median(kept, r->kept);
+}
+
+void Write_Results_Text(FILE* fp)
+{
+    fprintf(fp, "**************************************************************\n");
+    fprintf(fp, "Summary over %d repetitions (median / min / stddev, outliers rejected)\n", current_repeat);
+    for (int i = 0; i < result_count; i++) {
+        struct result* r = &results[i];
+        fprintf(fp, "[%s %s]\t %.3f / %.3f / %.3f %s (%d/%d kept)\n", r->test, r->point,
+                r->median, r->min, r->stddev, r->unit, r->kept, r->n);
+    }
+}
+
+void Write_Results_Csv(FILE* fp)
+{
+    fprintf(fp, "test,point,unit,n,kept,median,min,mean,stddev\n");
+    for (int i = 0; i < result_count; i++) {
+        struct result* r = &results[i];
+        fprintf(fp, "%s,%s,%s,%d,%d,%.6g,%.6g,%.6g,%.6g\n", r->test, r->point, r->unit,
+                r->n, r->kept, r->median, r->min, r->mean, r->stddev);
+    }
+}
+
+// 每个测试点单独占一行，便于 Load_Baseline 逐行解析
+void Write_Results_Json(FILE* fp)
+{
+    struct utsname host;
+    uname(&host);
+    fprintf(fp, "{\"host\": \"%s\", \"kernel\": \"%s\", \"repetitions\": %d, \"results\": [\n",
+            host.nodename, host.release, current_repeat);
+    for (int i = 0; i < result_count; i++) {
+        struct result* r = &results[i];
+        fprintf(fp, "{\"test\": \"%s\", \"point\": \"%s\", \"unit\": \"%s\", \"n\": %d, \"kept\": %d, "
+                "\"median\": %.6g, \"min\": %.6g, \"mean\": %.6g, \"stddev\": %.6g, \"samples\": [",
+                r->test, r->point, r->unit, r->n, r->kept, r->median, r->min, r->mean, r->stddev);
+        for (int j = 0; j < r->n; j++)
+            fprintf(fp, "%s%.6g", j ? ", " : "", r->samples[j]);
+        fprintf(fp, "]}%s\n", i + 1 < result_count ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+}
+
+// 从一行 JSON 中取出字符串/数值字段，找不到时返回 0
+int Json_Field(const char* line, const char* key, char* value, int size)
+{
+    char pattern[40];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    const char* p = strstr(line, pattern);
+    if (p == NULL)
+        return 0;
+    p += strlen(pattern);
+    int quoted = *p == '"';
+    p += quoted;
+    int len = 0;
+    while (p[len] && len < size - 1 && (quoted ? p[len] != '"' : p[len] != ',' && p[len] != '}'))
+        len++;
+    memcpy(value, p, len);
+    value[len] = '\0';
+    return 1;
+}
+
+// 读取 -c 指定的基线文件（本程序输出的 JSON 或 CSV），返回读入的测试点个数。
+// JSON 基线带有原始样本，CSV 基线只有汇总统计
+int Load_Baseline(const char* path, struct result* baseline, int capacity)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[4096];
+    int count = 0;
+    while (count < capacity && fgets(line, sizeof(line), fp)) {
+        struct result* r = &baseline[count];
+        memset(r, 0, sizeof(*r));
+        if (line[0] == '{') {
+            char n[16], median[32], mean[32], stddev[32];
+            if (!Json_Field(line, "test", r->test, sizeof(r->test)) || !Json_Field(line, "point", r->point, sizeof(r->point))
+                || !Json_Field(line, "unit", r->unit, sizeof(r->unit)) || !Json_Field(line, "kept", n, sizeof(n))
+                || !Json_Field(line, "median", median, sizeof(median)) || !Json_Field(line, "mean", mean, sizeof(mean))
+                || !Json_Field(line, "stddev", stddev, sizeof(stddev)))
+                continue;
+            r->kept = atoi(n);
+            r->median = atof(median);
+            r->mean = atof(mean);
+            r->stddev = atof(stddev);
+            const char* p = strstr(line, "\"samples\": [");
+            if (p != NULL) {
+                p += strlen("\"samples\": [");
+                char* end;
+                while (r->n < MAX_REPEATS) {
+                    double value = strtod(p, &end);
+                    if (end == p)
+                        break;
+                    r->samples[r->n++] = value;
+                    p = end;
+                    while (*p == ',' || *p == ' ')
+                        p++;
+                }
+            }
+        } else if (sscanf(line, "%31[^,],%47[^,],%15[^,],%d,%d,%lf,%lf,%lf,%lf", r->test, r->point, r->unit,
+                          &r->n, &r->kept, &r->median, &r->min, &r->mean, &r->stddev) == 9) {
+            r->n = 0;                                           // CSV 不含样本
+        } else {
+            continue;                                           // 表头或无法解析的行
+        }
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+// Mann-Whitney 秩和检验的 z 值（正态近似，含并列修正），对离群点不敏感
+double Rank_Test_Z(const double* a, int na, const double* b, int nb)
+{
+    double rank_sum = 0, ties = 0;
+    int n = na + nb;
+    // 逐个计算 a 中样本在合并样本里的平均秩
+    for (int i = 0; i < na; i++) {
+        int less = 0, equal = 0;
+        for (int j = 0; j < na; j++)
+            less += a[j] < a[i], equal += a[j] == a[i];
+        for (int j = 0; j < nb; j++)
+            less += b[j] < a[i], equal += b[j] == a[i];
+        rank_sum += less + (equal + 1) / 2.0;
+    }
+    // 并列修正项 sum(t^3 - t)
+    for (int i = 0; i < n; i++) {
+        double x = i < na ? a[i] : b[i - na];
+        int equal = 0, first = 1;
+        for (int j = 0; j < n; j++) {
+            double y = j < na ? a[j] : b[j - na];
+            if (y == x) {
+                equal++;
+                if (j < i)
+                    first = 0;
+            }
+        }
+        if (first)
+            ties += (double) equal * equal * equal - equal;
+    }
+    double u = rank_sum - na * (na + 1) / 2.0;
+    double mean = na * nb / 2.0;
+    double variance = na * nb / 12.0 * ((n + 1) - ties / ((double) n * (n - 1)));
+    return variance > 0 ? (u - mean) / sqrt(variance) : 0;
+}
+
+// 与基线逐点比较，返回显著退化的点数。显著需同时满足：
+//   中位数相对变化不低于 COMPARE_MIN_CHANGE；
+//   两侧都有至少 COMPARE_MIN_SAMPLES 个原始样本时 Mann-Whitney |z| >= COMPARE_Z（双侧 p < 0.01），
+//   否则 Welch 统计量 |t| >= COMPARE_Z。
+// 两种检验都凑不够样本（Welch 看保留样本数）时只报告样本不足，不计入退出状态；一个点也没能比较时返回 -2
+int Compare_Baseline(const char* path)
+{
+    static struct result baseline[MAX_RESULTS];
+    int count = Load_Baseline(path, baseline, MAX_RESULTS);
+    if (count < 0)
+        return -1;
+
+    printf("**************************************************************\n");
+    printf("Baseline Comparison (%s)\n", path);
+    int regressions = 0, insufficient = 0, compared = 0, max_rejected = 0;
+    for (int i = 0; i < result_count; i++) {
+        struct result* r = &results[i];
+        struct result* b = NULL;
+        for (int j = 0; j < count; j++) {
+            if (strcmp(baseline[j].test, r->test) == 0 && strcmp(baseline[j].point, r->point) == 0) {
+                b = &baseline[j];
+                break;
+            }
+        }
+        if (b == NULL) {
+            printf("[%s %s]\t not in baseline\n", r->test, r->point);
+            continue;
+        }
+        // 秩检验对离群值不敏感，直接用全部原始样本；Welch 只用剔除离群值后的样本
+        int rank = b->n >= COMPARE_MIN_SAMPLES && r->n >= COMPARE_MIN_SAMPLES;
+        if (!rank && (b->kept < COMPARE_MIN_SAMPLES || r->kept < COMPARE_MIN_SAMPLES)) {
+            printf("[%s %s]\t insufficient repetitions (%d baseline / %d current kept, need %d)\n",
+                   r->test, r->point, b->kept, r->kept, COMPARE_MIN_SAMPLES);
+            insufficient++;
+            // 离群值剔除会丢掉样本，建议的重复次数要把观察到的剔除数补上
+            if (b->n - b->kept > max_rejected)
+                max_rejected = b->n - b->kept;
+            if (r->n - r->kept > max_rejected)
+                max_rejected = r->n - r->kept;
+            continue;
+        }
+        compared++;
+        double diff = r->median - b->median;
+        double change = b->median != 0 ? diff / b->median : 0;
+        double statistic;
+        if (rank) {
+            statistic = Rank_Test_Z(r->samples, r->n, b->samples, b->n);
+        } else {
+            double se = sqrt(b->stddev * b->stddev / b->kept + r->stddev * r->stddev / r->kept);
+            statistic = se > 0 ? (r->mean - b->mean) / se : 0;
+        }
+        int significant = fabs(change) >= COMPARE_MIN_CHANGE && fabs(statistic) >= COMPARE_Z;
+        // 时间类指标越大越差，其余指标只报告变化
+        int timing = strcmp(r->unit, "us") == 0 || strcmp(r->unit, "cycles") == 0;
+        const char* verdict = !significant ? "ok" : !timing ? "CHANGED" : diff > 0 ? "REGRESSION" : "IMPROVEMENT";
+        if (significant && timing && diff > 0)
+            regressions++;
+        if (significant)
+            printf("[%s %s]\t %.3f -> %.3f %s (%+.1f%%, %s %.2f) %s\n", r->test, r->point, b->median, r->median,
+                   r->unit, change * 100, rank ? "z" : "t", statistic, verdict);
+    }
+    if (insufficient)
+        printf("%d points skipped for insufficient repetitions, rerun baseline and current with -n %d or more "
+               "(%d kept samples per side after outlier rejection)\n",
+               insufficient, COMPARE_MIN_SAMPLES + max_rejected, COMPARE_MIN_SAMPLES);
+    if (compared == 0) {
+        printf("No point could be compared against baseline\n");
+        return -2;
+    }
+    printf("%d significant regressions against baseline\n", regressions);
+    return regressions;
+}
+
+// perf_event_open 计数器：以 cycles 为组长，一次分组读取全部计数，可用时通过 rdpmc 在用户态直接读取。
+// 计数器组可能被复用或根本未被调度，因此同时读取 enabled/running 时间，按比例缩放，从未运行时报告 n/a
+#define PERF_EVENTS 5
+#define PERF_TIME_ENABLED PERF_EVENTS                           // 快照数组中紧跟计数值的两个时间槽
+#define PERF_TIME_RUNNING (PERF_EVENTS + 1)
+#define PERF_SNAPSHOT (PERF_EVENTS + 2)
+
+const char* perf_names[PERF_EVENTS] = { "cycles", "instructions", "L1D-miss", "LLC-miss", "dTLB-miss" };
+int perf_enabled = 0;                                           // 由 -p/--perf 打开
+int perf_fd[PERF_EVENTS];
+int perf_use_rdpmc = 0;
+unsigned long long perf_start[PERF_SNAPSHOT];
+double perf_total[PERF_EVENTS];                                 // 已按 enabled/running 缩放的累计值
+unsigned long long perf_total_enabled = 0, perf_total_running = 0;
+#ifdef __linux__
+struct perf_event_mmap_page* perf_page[PERF_EVENTS];
+#endif
+
+#ifdef __linux__
+int Perf_Open(unsigned int type, unsigned long long config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+#define PERF_CACHE_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+// 用户态 rdpmc 读取，计数器当前不可直接读取（未被调度或不支持用户态计时）时返回 0
+int Perf_Read_Rdpmc(unsigned long long* values)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    // 组长 mmap 页中的 enabled/running 只更新到上次调度，需用 TSC 补上之后的增量
+    struct perf_event_mmap_page* leader = perf_page[0];
+    unsigned int seq;
+    do {
+        seq = leader->lock;
+        __asm__ volatile("" ::: "memory");
+        if (!leader->cap_user_time || leader->index == 0)
+            return 0;
+        unsigned long long cycles = __rdtsc();
+        unsigned long long quot = cycles >> leader->time_shift;
+        unsigned long long rem = cycles & ((1ull << leader->time_shift) - 1);
+        unsigned long long delta = leader->time_offset + quot * leader->time_mult
+                                   + ((rem * leader->time_mult) >> leader->time_shift);
+        values[PERF_TIME_ENABLED] = leader->time_enabled + delta;
+        values[PERF_TIME_RUNNING] = leader->time_running + delta;
+        __asm__ volatile("" ::: "memory");
+    } while (leader->lock != seq);
+
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (perf_fd[e] < 0) {
+            values[e] = 0;
+            continue;
+        }
+        struct perf_event_mmap_page* pc = perf_page[e];
+        unsigned long long count;
+        do {
+            seq = pc->lock;
+            __asm__ volatile("" ::: "memory");
+            unsigned int index = pc->index;
+            if (!pc->cap_user_rdpmc || index == 0)
+                return 0;
+            long long pmc = __rdpmc(index - 1);
+            pmc <<= 64 - pc->pmc_width;
+            pmc >>= 64 - pc->pmc_width;
+            count = pc->offset + pmc;
+            __asm__ volatile("" ::: "memory");
+        } while (pc->lock != seq);
+        values[e] = count;
+    }
+    return 1;
+#else
+    (void) values;
+    return 0;
+#endif
+}
+#endif
+
+// 打开计数器组；在容器等无权限/无 PMU 的环境下关闭计数并给出提示
+void Perf_Init()
+{
+    if (!perf_enabled)
+        return;
+#ifdef __linux__
+    const unsigned int types[PERF_EVENTS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                              PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE };
+    const unsigned long long configs[PERF_EVENTS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                      PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D),
+                                                      PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL),
+                                                      PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) };
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        perf_fd[e] = Perf_Open(types[e], configs[e], e == 0 ? -1 : perf_fd[0]);
+        if (e == 0 && perf_fd[0] < 0) {
+            perror("perf_event_open");
+            printf("perf counters unavailable, reporting timings only\n");
+            perf_enabled = 0;
+            return;
+        }
+    }
+    // 组内任一计数器无法 mmap 或不支持 rdpmc 时退回分组 read()
+    perf_use_rdpmc = 1;
+    long page_size = sysconf(_SC_PAGESIZE);
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        perf_page[e] = NULL;
+        if (perf_fd[e] < 0)
+            continue;
+        void* page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, perf_fd[e], 0);
+        if (page == MAP_FAILED) {
+            perf_use_rdpmc = 0;
+            continue;
+        }
+        perf_page[e] = (struct perf_event_mmap_page*) page;
+        if (!perf_page[e]->cap_user_rdpmc)
+            perf_use_rdpmc = 0;
+    }
+    ioctl(perf_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    unsigned long long probe[PERF_SNAPSHOT];
+    if (perf_use_rdpmc && !Perf_Read_Rdpmc(probe))
+        perf_use_rdpmc = 0;
+    printf("perf counters enabled (%s)\n", perf_use_rdpmc ? "rdpmc" : "grouped read");
+#else
+    printf("perf counters unavailable on this platform, reporting timings only\n");
+    perf_enabled = 0;
+#endif
+}
+
+// 读取组内全部计数器的当前值及 enabled/running 时间，打开失败的计数器记为 0
+void Perf_Read(unsigned long long* values)
+{
+#ifdef __linux__
+    if (perf_use_rdpmc && Perf_Read_Rdpmc(values))
+        return;
+    unsigned long long buffer[PERF_EVENTS + 3];
+    if (read(perf_fd[0], buffer, sizeof(buffer)) < (ssize_t) (3 * sizeof(unsigned long long))) {
+        memset(values, 0, PERF_SNAPSHOT * sizeof(unsigned long long));
+        return;
+    }
+    // nr, time_enabled, time_running 之后按打开顺序排列成功打开的计数器
+    values[PERF_TIME_ENABLED] = buffer[1];
+    values[PERF_TIME_RUNNING] = buffer[2];
+    unsigned long long slot = 0;
+    for (int e = 0; e < PERF_EVENTS; e++)
+        values[e] = perf_fd[e] >= 0 && slot < buffer[0] ? buffer[3 + slot++] : 0;
+#else
+    memset(values, 0, PERF_SNAPSHOT * sizeof(unsigned long long));
+#endif
+}
+
+// 测试段开始前记录计数快照
+void Perf_Begin()
+{
+    if (perf_enabled)
+        Perf_Read(perf_start);
+}
+
+// 测试段结束后把增量按 enabled/running 缩放后累加到 perf_total；该段计数器从未运行时不累加
+void Perf_End()
+{
+    if (!perf_enabled)
+        return;
+    unsigned long long now[PERF_SNAPSHOT];
+    Perf_Read(now);
+    unsigned long long enabled = now[PERF_TIME_ENABLED] - perf_start[PERF_TIME_ENABLED];
+    unsigned long long running = now[PERF_TIME_RUNNING] - perf_start[PERF_TIME_RUNNING];
+    if (running == 0)
+        return;
+    double scale = (double) enabled / running;
+    for (int e = 0; e < PERF_EVENTS; e++)
+        perf_total[e] += (now[e] - perf_start[e]) * scale;
+    perf_total_enabled += enabled;
+    perf_total_running += running;
+}
+
+// 紧跟在计时结果后输出累计计数（按每次访存归一化）并清零
+void Perf_Print(unsigned long accesses)
+{
+    if (!perf_enabled)
+        return;
+    printf("\t\t\t\t perf:");
+    if (perf_total_running == 0) {
+        // 计数器组在测试段内从未被调度（常见于虚拟机或计数器不足的 PMU）
+        for (int e = 0; e < PERF_EVENTS; e++)
+            printf(" %s n/a", perf_names[e]);
+        printf(" (not scheduled)\n");
+        return;
+    }
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (perf_fd[e] < 0) {
+            printf(" %s n/a", perf_names[e]);
+        } else {
+            printf(" %s %.3f", perf_names[e], perf_total[e] / accesses);
+            Record_Result(last_test, "per_access", perf_total[e] / accesses, "%s/%s", last_point, perf_names[e]);
+        }
+    }
+    if (perf_total_running < perf_total_enabled)
+        printf(" (per access, scaled from %.0f%% running)\n", 100.0 * perf_total_running / perf_total_enabled);
+    else
+        printf(" (per access)\n");
+    memset(perf_total, 0, sizeof(perf_total));
+    perf_total_enabled = perf_total_running = 0;
+}
+
 // have an access to arrays with L2 Data Cache'size to clear the L1 cache
 void Clear_L1_Cache()
 {
-    memset(array, 0, L2_cache_size);
+    Evict_Walk(L2_cache_size);
 }
 
-// have an access to arrays with ARRAY_SIZE to clear the L2 cache
+// walk the whole eviction buffer (2x LLC) to clear the L2 cache
 void Clear_L2_Cache()
 {
-    memset(array, 0, ARRAY_SIZE);
+    Evict_Walk(evict_size);
 }
 
 void Test_Cache_Size()
@@ -34,6 +774,8 @@ void Test_Cache_Size()
     printf("**************************************************************\n");
     printf("Cache Size Test\n");
 
+    srand(TRACE_SEED);
+
     for (int offset = 10; offset < 20; offset++) {
         unsigned long bound = 1 << offset;
         // 将数组划分为四块进行访问（因为整段数组进行访存结果不明显）
@@ -47,12 +789,16 @@ void Test_Cache_Size()
         struct timeval tp[2];
         // 测试次数
         register unsigned long cache_test_time = 1 << 15;
-        // 消除L2Cache的影响
-        Clear_L2_Cache();
+        // 消除L2Cache的影响（只刷出本次测试用到的四块）
+        Evict_Range(part_0, mod);
+        Evict_Range(part_1, mod);
+        Evict_Range(part_2, mod);
+        Evict_Range(part_3, mod);
 
         /*
          * 测试段
          */
+        Perf_Begin();
         gettimeofday(&tp[0], NULL);
         for (register unsigned long i = 0; i < cache_test_time; i++) {
             // 随机地址
@@ -63,9 +809,12 @@ void Test_Cache_Size()
             part_3[index] = i;
         }
         gettimeofday(&tp[1], NULL);
+        Perf_End();
 
         // 输出数据
         printf("[Test_Array_Size = %-5ldKB]\t Average access time: %.3lf us\n", (bound >> 10), get_usec(tp[0], tp[1]));
+        Record_Result("cache_size", "us", get_usec(tp[0], tp[1]), "%ldKB", bound >> 10);
+        Perf_Print(cache_test_time << 2);
         free(part_0);
         free(part_1);
         free(part_2);
@@ -78,36 +827,42 @@ void Test_L1C_Block_Size()
     printf("**************************************************************\n");
     printf("L1 DCache Block Size Test\n");
 
+    // 测试次数
+    const unsigned long block_test_time = 1 << 15;
+    // 测试数组只需覆盖最大间隔下的访问范围，一次分配供所有间隔复用
+    const unsigned long block_array_size = block_test_time << 9;
+    BYTE* test_array = Alloc_Buffer(block_array_size);
+
     Clear_L1_Cache();											// Clear L1 Cache
 
     for (unsigned long offset = 4; offset < 10; offset++) {
-        // 申请测试数组空间
-        BYTE* test_array = (BYTE*) malloc(ARRAY_SIZE);
         // 数组访问间隔
         unsigned long jump = 1u << offset;
-        // 刷新L1Cache
-        Clear_L1_Cache();
+        // 刷新测试数组所在的 Cache 行
+        Evict_Range(test_array, block_test_time * jump);
         // 记录访存时间
         struct timeval tp[2];
-        // 测试次数
-        register unsigned long block_test_time = 1 << 15;
         // 数组起始下标
         register unsigned long index = 0;
 
         /*
          * 测试段
          */
+        Perf_Begin();
         gettimeofday(&tp[0], NULL);
         for (register unsigned long i = 0; i < block_test_time; i++) {
             test_array[index] = i;
-            index = (index + jump) % ARRAY_SIZE;
+            index = (index + jump) % block_array_size;
         }
         gettimeofday(&tp[1], NULL);
+        Perf_End();
 
         // 输出数据
         printf("[Test_Array_Jump = %-3ldB]\t Average access time: %3f us\n", jump, get_usec(tp[0], tp[1]));
-        free(test_array);
+        Record_Result("l1_block_size", "us", get_usec(tp[0], tp[1]), "%ldB", jump);
+        Perf_Print(block_test_time);
     }
+    Free_Buffer(test_array, block_array_size);
 }
 
 void Test_L2C_Block_Size()
@@ -128,7 +883,7 @@ void Test_L1C_Way_Count()
     // L1_DCache大小
     register unsigned long cache_size = 1 << 15;
     // 申请 2 * cache_size 的数组空间
-    BYTE* test_array = (BYTE*) malloc(cache_size << 1);
+    BYTE* test_array = Alloc_Buffer(cache_size << 1);
     // 组相联测试次数
     register unsigned long way_count_test_time = 1 << 20;
     // 将数组平均分成 2^n 组
@@ -136,13 +891,14 @@ void Test_L1C_Way_Count()
         // 确定最大组数
         register unsigned long group_max_index = (cache_size << 1) / group_size;
         // 刷新L2Cache
-        Clear_L2_Cache();
+        Evict_Range(test_array, cache_size << 1);
         // 记录耗时
         struct timeval tp[2];
 
         /*
          * 测试段
          */
+        Perf_Begin();
         gettimeofday(&tp[0], NULL);
         // 保证访存次数相同
         int cnt = 0;
@@ -157,11 +913,14 @@ void Test_L1C_Way_Count()
             }
         }
         gettimeofday(&tp[1], NULL);
+        Perf_End();
 
         // 输出结果
         printf("[Test_Split_Groups = %-3ld]\t Average access time : %.3f us\n", group_size, get_usec(tp[0], tp[1]));
+        Record_Result("l1_way_count", "us", get_usec(tp[0], tp[1]), "%ld", group_size);
+        Perf_Print(cnt);
     }
-    free(test_array);
+    Free_Buffer(test_array, cache_size << 1);
 }
 
 void Test_L2C_Way_Count()
@@ -172,12 +931,383 @@ void Test_L2C_Way_Count()
     // TODO
 }
 
+// 生成 0..n-1 的随机排列
+void Shuffle_Order(unsigned long* order, unsigned long n)
+{
+    for (unsigned long i = 0; i < n; i++)
+        order[i] = i;
+    for (unsigned long i = n - 1; i > 0; i--) {
+        unsigned long j = rand() % (i + 1);
+        unsigned long tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+// 按 offsets 给定的字节偏移顺序把各位置首尾相连成指针环，返回起点
+void** Build_Chain(BYTE* buffer, const unsigned long* offsets, unsigned long n)
+{
+    for (unsigned long i = 0; i < n; i++)
+        *(void**) (buffer + offsets[i]) = buffer + offsets[(i + 1) % n];
+    return (void**) (buffer + offsets[0]);
+}
+
+// 构造一个随机顺序的指针环（每行一个指针），返回起点
+void** Build_Chase_Ring(BYTE* buffer, unsigned long lines)
+{
+    unsigned long* order = (unsigned long*) malloc(lines * sizeof(unsigned long));
+    Shuffle_Order(order, lines);
+    for (unsigned long i = 0; i < lines; i++)
+        order[i] *= CACHE_LINE_SIZE;
+    void** start = Build_Chain(buffer, order, lines);
+    free(order);
+    return start;
+}
+
+// 沿指针环走 steps 步，返回平均每步耗时（周期）
+double Chase_Ring(void** start, unsigned long steps)
+{
+    void** p = start;
+    unsigned long long t0 = get_cycles();
+    for (unsigned long i = 0; i < steps; i++)
+        p = (void**) *p;
+    unsigned long long t1 = get_cycles();
+    evict_sink = (BYTE) (unsigned long) p;
+    return (double) (t1 - t0) / steps;
+}
+
+// 每行写入一个字，返回平均每行耗时（周期）
+double Time_Line_Stores(BYTE* buffer, unsigned long size, unsigned long rounds)
+{
+    unsigned long long t0 = get_cycles();
+    for (unsigned long r = 0; r < rounds; r++)
+        for (unsigned long i = 0; i < size; i += CACHE_LINE_SIZE)
+            *(volatile unsigned long*) (buffer + i) = r;
+    unsigned long long t1 = get_cycles();
+    return (double) (t1 - t0) / (rounds * (size / CACHE_LINE_SIZE));
+}
+
+// 依次读取间隔为 stride 的 n 行，下一地址依赖上一次读到的值（缓冲区内容为 0），返回平均每行耗时
+double Chase_Lines(BYTE* buffer, unsigned long n, unsigned long stride)
+{
+    unsigned long index = 0;
+    unsigned long long t0 = get_cycles();
+    for (unsigned long i = 1; i <= n; i++)
+        index = i * stride + buffer[index];
+    unsigned long long t1 = get_cycles();
+    evict_sink = index;
+    return (double) (t1 - t0) / n;
+}
+
+// 按写带宽之比判定写命中策略，模拟器回放时共用
+const char* Classify_Write_Hit(double store_ratio, double load_ratio, double* score)
+{
+    const char* policy;
+    if (store_ratio > 1.3) {
+        policy = "write-back";
+        *score = (store_ratio - 1.3) / 0.5;
+    } else {
+        policy = "write-through";
+        *score = (1.3 - store_ratio) / 0.25;
+        // 读也看不出层级差异时说明两种规模没有落在不同层级，结论不可信
+        if (load_ratio < 1.2)
+            *score *= 0.5;
+    }
+    if (*score > 1)
+        *score = 1;
+    return policy;
+}
+
+// 写命中策略：L1 驻留与 L2 驻留两种规模下的写带宽之比。写回时 L1 内的写远快于 L2，写直达时二者接近。
+// 读延迟的对照用乱序指针环测，顺序读会被预取掩盖层级差异
+void Probe_Write_Hit_Policy(unsigned long l1_size)
+{
+    unsigned long small_size = l1_size >> 1;
+    unsigned long large_size = l1_size << 3;
+    unsigned long small_lines = small_size / CACHE_LINE_SIZE;
+    unsigned long large_lines = large_size / CACHE_LINE_SIZE;
+    BYTE* buffer = Alloc_Buffer(large_size);
+    double store_small[PROBE_TRIALS], store_large[PROBE_TRIALS];
+    double load_small[PROBE_TRIALS], load_large[PROBE_TRIALS];
+
+    // 写入落在行内偏移 0，两个指针环分别放在偏移 8 和 16 处
+    srand(TRACE_SEED);
+    void** small_ring = Build_Chase_Ring(buffer + sizeof(void*), small_lines);
+    void** large_ring = Build_Chase_Ring(buffer + 2 * sizeof(void*), large_lines);
+
+    for (int t = 0; t < PROBE_TRIALS; t++) {
+        Time_Line_Stores(buffer, small_size, 1);                // warm up
+        store_small[t] = Time_Line_Stores(buffer, small_size, 16);
+        store_large[t] = Time_Line_Stores(buffer, large_size, 2);
+        Chase_Ring(small_ring, small_lines);
+        load_small[t] = Chase_Ring(small_ring, 16 * small_lines);
+        load_large[t] = Chase_Ring(large_ring, 2 * large_lines);
+    }
+    double store_ratio = Median(store_large, PROBE_TRIALS) / Median(store_small, PROBE_TRIALS);
+    double load_ratio = Median(load_large, PROBE_TRIALS) / Median(load_small, PROBE_TRIALS);
+
+    double score;
+    const char* policy = Classify_Write_Hit(store_ratio, load_ratio, &score);
+
+    printf("[Write_Hit_Policy = %-19s]\t store L2/L1 = %.2f, load L2/L1 = %.2f, confidence: %s (%.2f)\n",
+           policy, store_ratio, load_ratio, Confidence_Level(score), score);
+    Record_Result("write_hit_policy", "ratio", store_ratio, "store_l2_l1");
+    Record_Result("write_hit_policy", "ratio", load_ratio, "load_l2_l1");
+    Free_Buffer(buffer, large_size);
+}
+
+// 按写后读的延迟落在命中与缺失之间的位置判定写缺失策略，模拟器回放时共用
+const char* Classify_Write_Miss(double t_hit, double t_miss, double t_store_load, double* score)
+{
+    // frac 为 0 表示写后读全部命中，为 1 表示全部缺失
+    double frac = t_miss > t_hit ? (t_store_load - t_hit) / (t_miss - t_hit) : 0.5;
+    *score = 2 * (frac < 0.5 ? 0.5 - frac : frac - 0.5);
+    if (*score > 1)
+        *score = 1;
+    if (t_miss < 2 * t_hit)                                     // 命中与缺失区分度不足
+        *score *= 0.5;
+    return frac < 0.5 ? "write-allocate" : "no-write-allocate";
+}
+
+// 写缺失策略：先刷出若干行再写入，随后依赖链读取。写分配时读取接近命中，不分配时接近缺失
+void Probe_Write_Miss_Policy()
+{
+    // 跨页 + 一行的间隔避开相邻行/同页预取，且各行落在不同组
+    const unsigned long stride = sysconf(_SC_PAGESIZE) + CACHE_LINE_SIZE;
+    const unsigned long lines = 64;
+    const unsigned long size = stride * (lines + 1);
+    BYTE* buffer = Alloc_Buffer(size);
+    double hit[PROBE_TRIALS], miss[PROBE_TRIALS], store_load[PROBE_TRIALS];
+
+    for (int t = 0; t < PROBE_TRIALS; t++) {
+        Evict_Range(buffer, size);
+        miss[t] = Chase_Lines(buffer, lines, stride);
+        hit[t] = Chase_Lines(buffer, lines, stride);
+
+        Evict_Range(buffer, size);
+        for (unsigned long i = 0; i < lines; i++)          // 与 Chase_Lines 读取的 0..lines-1 行一致
+            *(volatile BYTE*) (buffer + i * stride) = 0;
+        __asm__ volatile("" ::: "memory");
+        store_load[t] = Chase_Lines(buffer, lines, stride);
+    }
+    double t_hit = Median(hit, PROBE_TRIALS);
+    double t_miss = Median(miss, PROBE_TRIALS);
+    double t_store_load = Median(store_load, PROBE_TRIALS);
+
+    double score;
+    const char* policy = Classify_Write_Miss(t_hit, t_miss, t_store_load, &score);
+
+    printf("[Write_Miss_Policy = %-18s]\t hit %.1f / miss %.1f / store-then-load %.1f cycles, confidence: %s (%.2f)\n",
+           policy, t_hit, t_miss, t_store_load, Confidence_Level(score), score);
+    Record_Result("write_miss_policy", "cycles", t_hit, "hit");
+    Record_Result("write_miss_policy", "cycles", t_miss, "miss");
+    Record_Result("write_miss_policy", "cycles", t_store_load, "store_then_load");
+    Free_Buffer(buffer, size);
+}
+
 void Test_Cache_Write_Policy()
 {
     printf("**************************************************************\n");
     printf("Cache Write Policy Test\n");
 
-    // TODO
+    unsigned long l1_size, l1_assoc, l1_line;
+    Detect_L1_Geometry(&l1_size, &l1_assoc, &l1_line);
+
+    Probe_Write_Hit_Policy(l1_size);
+    Probe_Write_Miss_Policy();
+}
+
+// 按各路被替换的比例判定替换策略，top 返回最常被替换的路，others 为其余各路的平均比例
+const char* Classify_L1_Replacement(const double* miss_rate, unsigned long ways, unsigned long* top, double* others, double* score)
+{
+    double total = 0;
+    *top = 0;
+    for (unsigned long k = 0; k < ways; k++) {
+        total += miss_rate[k];
+        if (miss_rate[k] > miss_rate[*top])
+            *top = k;
+    }
+    *others = (total - miss_rate[*top]) / (ways - 1);
+
+    if (miss_rate[*top] >= 0.75 && *others < 0.15) {
+        *score = miss_rate[*top] - *others;
+        return *top == 0 ? "FIFO" : *top == 1 ? "LRU" : "tree-PLRU";
+    }
+    if (miss_rate[*top] < 0.5 && total >= 0.5) {
+        *score = 1 - miss_rate[*top];
+        return "random";
+    }
+    // 多路同时表现为缺失：噪声过大或策略不符合以上任何一种
+    *score = 0.25;
+    return "unknown";
+}
+
+// 同组替换顺序：依次装满一组 (0..W-1)，再访问 0，再插入新行 W，观察哪一路被替换
+//   LRU: 替换 1；FIFO: 替换 0；tree-PLRU: 固定替换其他某一路；随机: 被替换的路分散
+void Probe_L1_Replacement(unsigned long l1_size, unsigned long l1_assoc)
+{
+    const unsigned long ways = l1_assoc;
+    const unsigned long way_stride = l1_size / l1_assoc;        // 同一组相邻两行的地址间隔
+    const unsigned long set_offset = 37 * CACHE_LINE_SIZE;      // 避开 0 号组，减少栈/全局变量干扰
+    if (ways < 2 || way_stride < 64 * CACHE_LINE_SIZE) {
+        printf("[L1_Replace_Policy = %-17s]\t unsupported L1 geometry, confidence: low (0.00)\n", "skipped");
+        return;
+    }
+    const unsigned long lines = 4 * ways + 1;
+    const unsigned long size = lines * way_stride;
+    BYTE* buffer = Alloc_Buffer(size);
+    // 地址直接计算而不放在栈上的数组里，避免探测过程本身的访存落入目标组
+    BYTE* base = buffer + set_offset;
+#define LINE(k) (base + (k) * way_stride)
+
+    // 校准：L1 命中与 L1 缺失（L2 命中）的单次读延迟
+    double hit[PROBE_TRIALS], miss[PROBE_TRIALS];
+    for (int t = 0; t < PROBE_TRIALS; t++) {
+        evict_sink = *LINE(0);
+        hit[t] = Time_Load(LINE(0));
+        for (unsigned long k = 1; k < lines; k++)
+            evict_sink = *LINE(k);
+        miss[t] = Time_Load(LINE(0));
+    }
+    double t_hit = Median(hit, PROBE_TRIALS);
+    double t_miss = Median(miss, PROBE_TRIALS);
+    double threshold = (t_hit + t_miss) / 2;
+
+    double miss_rate[ways];
+    for (unsigned long victim = 0; victim < ways; victim++) {
+        int misses = 0;
+        for (int t = 0; t < 4 * PROBE_TRIALS; t++) {
+            for (unsigned long k = ways + 1; k < lines; k++)   // 用其他行清洗该组
+                evict_sink = *LINE(k);
+            for (unsigned long k = 0; k < ways; k++)
+                evict_sink = *LINE(k);
+            evict_sink = *LINE(0);
+            evict_sink = *LINE(ways);
+            if (Time_Load(LINE(victim)) > threshold)
+                misses++;
+        }
+        miss_rate[victim] = (double) misses / (4 * PROBE_TRIALS);
+    }
+#undef LINE
+
+    unsigned long top;
+    double others, score;
+    const char* policy = Classify_L1_Replacement(miss_rate, ways, &top, &others, &score);
+    if (t_miss - t_hit < 4)                                     // 命中与缺失几乎不可区分
+        score *= 0.5;
+
+    printf("[L1_Replace_Policy = %-17s]\t victim way %-2lu (%.2f), others %.2f, hit %.0f / miss %.0f cycles, confidence: %s (%.2f)\n",
+           policy, top, miss_rate[top], others, t_hit, t_miss, Confidence_Level(score), score);
+    Record_Result("l1_replacement", "ratio", miss_rate[top], "victim_miss_rate");
+    Record_Result("l1_replacement", "ratio", others, "other_miss_rate");
+    Free_Buffer(buffer, size);
+}
+
+// 由命中/缺失基准和两种模式的延迟判定替换策略，模拟器回放时共用。
+// retained：抖动稳态下仍命中该级的比例（上限约 LLC / 工作集 = 0.8）；hot_kept：扫描后热集仍命中的比例
+const char* Classify_LLC_Replacement(double t_hit, double t_miss, double t_cyclic, double t_after_scan,
+                                     double* retained, double* hot_kept, double* score)
+{
+    *retained = t_miss > t_hit ? (t_miss - t_cyclic) / (t_miss - t_hit) : 0;
+    *hot_kept = t_miss > t_hit ? (t_miss - t_after_scan) / (t_miss - t_hit) : 0;
+    *retained = *retained < 0 ? 0 : *retained > 1 ? 1 : *retained;
+    *hot_kept = *hot_kept < 0 ? 0 : *hot_kept > 1 ? 1 : *hot_kept;
+    const char* policy;
+    if (*retained < 0.1 && *hot_kept < 0.15) {
+        policy = "LRU-like";
+        *score = 1 - (*retained + *hot_kept) / 0.25 * 0.5;
+    } else if (*hot_kept >= 0.6) {
+        policy = "adaptive";
+        *score = (*hot_kept - 0.45) / 0.3;
+    } else if (*hot_kept >= 0.2 && *hot_kept < 0.55 && *retained > 0.15) {
+        policy = "random";
+        *score = 1 - (*hot_kept > 0.37 ? *hot_kept - 0.37 : 0.37 - *hot_kept) / 0.2;
+    } else {
+        policy = "unclear";
+        *score = 0.3;
+    }
+    if (*score > 1)
+        *score = 1;
+    if (t_miss < 2 * t_hit)
+        *score *= 0.5;
+    return policy;
+}
+
+// LLC 替换策略测试，两种访存模式：
+//   循环抖动：以固定顺序循环访问 1.25 倍 LLC 的工作集。LRU 下每次访问都缺失，随机替换或自适应插入会保留一部分
+//   热集+扫描：先反复访问半个 LLC 的热集，再顺序扫描一个 LLC 大小的冷数据，然后测热集还剩多少。
+//   LRU 下热集被完全挤出，随机替换约保留 e^-1 ≈ 0.37，抗扫描的自适应插入（如 Intel L3 的 DIP/DRRIP）保留大部分
+// LLC 物理寻址且按切片哈希，用户态无法构造同组访问序列，因此用整个 LLC 规模的工作集代替逐组序列。
+// LLC 大到探测缓冲区放不下时退而探测 L2（last_level 为 0），此时缺失基准是“L2 缺失、下一级命中”而不是访存
+void Probe_LLC_Replacement(unsigned long llc_size, int last_level)
+{
+    const char* level = last_level ? "LLC" : "L2";
+    const unsigned long hot_size = llc_size >> 1;
+    const unsigned long thrash_size = llc_size + (llc_size >> 2);
+    const unsigned long buffer_size = hot_size + llc_size;      // 热集之后紧跟扫描区，也覆盖抖动工作集
+    if (llc_size == 0 || buffer_size > PROBE_MAX_SIZE) {
+        printf("[LLC_Replace_Policy = %-16s]\t %s of %lu KB exceeds probe buffer limit, confidence: low (0.00)\n",
+               "skipped", level, llc_size >> 10);
+        return;
+    }
+    BYTE* buffer = Alloc_Buffer(buffer_size);
+    const unsigned long hot_steps = hot_size / CACHE_LINE_SIZE;
+    const unsigned long thrash_steps = thrash_size / CACHE_LINE_SIZE;
+    const unsigned long scan_steps = llc_size / CACHE_LINE_SIZE;
+
+    // 几个指针环落在同样的行上，分别放在行内偏移 0、8、16 处以免互相覆盖
+    srand(TRACE_SEED);
+    void** hot = Build_Chase_Ring(buffer + sizeof(void*), hot_steps);
+    void** thrash = Build_Chase_Ring(buffer, thrash_steps);
+    void** scan = Build_Chase_Ring(buffer + hot_size + 2 * sizeof(void*), scan_steps);
+
+    double hit[PROBE_TRIALS / 4], miss[PROBE_TRIALS / 4], cyclic[PROBE_TRIALS / 4], after_scan[PROBE_TRIALS / 4];
+    for (int t = 0; t < PROBE_TRIALS / 4; t++) {
+        // 命中/缺失基准：热集驻留 LLC 时与刚被刷出时的每次访问延迟
+        Chase_Ring(hot, hot_steps);
+        hit[t] = Chase_Ring(hot, hot_steps);
+        Evict_Range(buffer, hot_size);
+        if (!last_level) {
+            // 热集先装入各级，再用两圈一个 L2 大小的乱序环把它挤到下一级
+            Chase_Ring(hot, hot_steps);
+            Chase_Ring(scan, scan_steps);
+            Chase_Ring(scan, scan_steps);
+        }
+        miss[t] = Chase_Ring(hot, hot_steps);
+
+        // 循环抖动：多跑几圈让替换策略进入稳态
+        Evict_Range(buffer, thrash_size);
+        for (int lap = 0; lap < 3; lap++)
+            Chase_Ring(thrash, thrash_steps);
+        cyclic[t] = Chase_Ring(thrash, thrash_steps);
+
+        // 热集+扫描
+        Chase_Ring(hot, hot_steps);
+        Chase_Ring(hot, hot_steps);
+        BYTE sum = 0;
+        for (unsigned long i = hot_size; i < buffer_size; i += CACHE_LINE_SIZE)
+            sum += *(volatile BYTE*) (buffer + i);
+        evict_sink = sum;
+        after_scan[t] = Chase_Ring(hot, hot_steps);
+    }
+    double t_hit = Median(hit, PROBE_TRIALS / 4);
+    double t_miss = Median(miss, PROBE_TRIALS / 4);
+    double t_cyclic = Median(cyclic, PROBE_TRIALS / 4);
+    double t_after_scan = Median(after_scan, PROBE_TRIALS / 4);
+
+    double retained, hot_kept, score;
+    const char* policy = Classify_LLC_Replacement(t_hit, t_miss, t_cyclic, t_after_scan, &retained, &hot_kept, &score);
+
+    if (!last_level)
+        score *= 0.5;
+
+    printf("[LLC_Replace_Policy = %-16s]\t %s: hit %.0f / miss %.0f / cyclic %.0f / after scan %.0f cycles, "
+           "retained %.2f, hot kept %.2f, confidence: %s (%.2f)\n",
+           policy, level, t_hit, t_miss, t_cyclic, t_after_scan, retained, hot_kept, Confidence_Level(score), score);
+    Record_Result("llc_replacement", "cycles", t_cyclic, "cyclic");
+    Record_Result("llc_replacement", "ratio", retained, "retained");
+    Record_Result("llc_replacement", "ratio", hot_kept, "hot_kept");
+    Free_Buffer(buffer, buffer_size);
 }
 
 void Test_Cache_Swap_Method()
@@ -185,7 +1315,184 @@ void Test_Cache_Swap_Method()
     printf("**************************************************************\n");
     printf("Cache Replace Method Test\n");
 
-    // TODO
+    unsigned long l1_size, l1_assoc, l1_line;
+    Detect_L1_Geometry(&l1_size, &l1_assoc, &l1_line);
+
+    Probe_L1_Replacement(l1_size, l1_assoc);
+    // LLC 超出探测缓冲区时退而测 L2，结论只作参考
+    unsigned long llc_size = Detect_LLC_Size();
+    if (llc_size + (llc_size >> 1) <= PROBE_MAX_SIZE) {
+        Probe_LLC_Replacement(llc_size, 1);
+    } else {
+        long l2_size = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        l2_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        printf("LLC of %lu KB exceeds probe buffer limit, probing L2 instead\n", llc_size >> 10);
+        Probe_LLC_Replacement(l2_size > 0 ? (unsigned long) l2_size : 0, 0);
+    }
+}
+
+#define PREFETCH_REGION (4ul << 20)                             // 预取测试区域大小
+#define PREFETCH_STEPS 4096                                     // 每个访存模式的最大访问次数
+
+// 冷启动沿 offsets 顺序访问一遍（每次先刷出整个区域），返回多次试验的每次访问延迟中位数
+double Time_Cold_Chain(BYTE* buffer, const unsigned long* offsets, unsigned long n)
+{
+    double samples[PROBE_TRIALS / 4];
+    void** start = Build_Chain(buffer, offsets, n);
+    for (int t = 0; t < PROBE_TRIALS / 4; t++) {
+        Evict_Range(buffer, PREFETCH_REGION);
+        Perf_Begin();
+        samples[t] = Chase_Ring(start, n);
+        Perf_End();
+    }
+    return Median(samples, PROBE_TRIALS / 4);
+}
+
+// 覆盖率：预取隐藏掉的缺失延迟占比，0 表示与随机访问一样慢，1 表示与命中一样快
+double Prefetch_Coverage(double latency, double t_random, double t_hit)
+{
+    double coverage = t_random > t_hit ? (t_random - latency) / (t_random - t_hit) : 0;
+    return coverage < 0 ? 0 : coverage > 1 ? 1 : coverage;
+}
+
+// 软件预取距离扫描：沿随机顺序的指针链访问，每个节点的第二个字指向 distance 步之后的节点。
+// 预取地址取自刚读到的行，乱序执行无法越过链上的缺失提前发出预取，预取提前量只由 distance 决定
+double Time_Software_Prefetch(BYTE* buffer, const unsigned long* offsets, unsigned long n, unsigned long distance)
+{
+    double samples[PROBE_TRIALS / 4];
+    void** start = Build_Chain(buffer, offsets, n);
+    for (unsigned long i = 0; i < n; i++)
+        ((void**) (buffer + offsets[i]))[1] = buffer + offsets[(i + distance) % n];
+    for (int t = 0; t < PROBE_TRIALS / 4; t++) {
+        Evict_Range(buffer, PREFETCH_REGION);
+        void** p = start;
+        unsigned long long t0 = get_cycles();
+        for (unsigned long i = 0; i < n; i++) {
+            __builtin_prefetch(p[1]);                           // distance 为 0 时预取的是当前行，作为基准
+            p = (void**) *p;
+        }
+        unsigned long long t1 = get_cycles();
+        evict_sink = (BYTE) (unsigned long) p;
+        samples[t] = (double) (t1 - t0) / n;
+    }
+    return Median(samples, PROBE_TRIALS / 4);
+}
+
+void Test_Prefetcher()
+{
+    printf("**************************************************************\n");
+    printf("Hardware Prefetcher Test\n");
+
+    const unsigned long page_size = sysconf(_SC_PAGESIZE);
+    BYTE* buffer = Alloc_Buffer(PREFETCH_REGION);
+    unsigned long* offsets = (unsigned long*) malloc(PREFETCH_STEPS * sizeof(unsigned long));
+    const unsigned long lines = PREFETCH_REGION / CACHE_LINE_SIZE;
+
+    // 基准：随机顺序访问，预取器无法预测
+    srand(TRACE_SEED);
+    unsigned long* order = (unsigned long*) malloc(lines * sizeof(unsigned long));
+    Shuffle_Order(order, lines);
+    for (unsigned long i = 0; i < PREFETCH_STEPS; i++)
+        offsets[i] = order[i] * CACHE_LINE_SIZE;
+    double t_random = Time_Cold_Chain(buffer, offsets, PREFETCH_STEPS);
+    Chase_Ring((void**) (buffer + offsets[0]), PREFETCH_STEPS);
+    double t_hit = Chase_Ring((void**) (buffer + offsets[0]), PREFETCH_STEPS);
+    printf("[Baseline]\t random %.1f cycles, hit %.1f cycles\n", t_random, t_hit);
+    Record_Result("prefetch", "cycles", t_hit, "hit");
+    Record_Result("prefetch", "cycles", t_random, "random");
+    Perf_Print(PREFETCH_STEPS * (PROBE_TRIALS / 4));
+
+    // 固定步长（正向/反向，含跨页步长）
+    const long strides[] = { 64, 128, 256, 512, 1024, 2048, 4096, 4096 + 64 };
+    const int stride_count = sizeof(strides) / sizeof(strides[0]);
+    long max_covered_stride = 0;
+    int backward_covered = 0;
+    for (int s = 0; s < stride_count; s++) {
+        for (int direction = 1; direction >= -1; direction -= 2) {
+            long stride = strides[s] * direction;
+            unsigned long n = PREFETCH_REGION / strides[s];
+            if (n > PREFETCH_STEPS)
+                n = PREFETCH_STEPS;
+            for (unsigned long i = 0; i < n; i++)
+                offsets[i] = direction > 0 ? i * strides[s] : (n - 1 - i) * strides[s];
+            double latency = Time_Cold_Chain(buffer, offsets, n);
+            double coverage = Prefetch_Coverage(latency, t_random, t_hit);
+            if (coverage >= 0.5) {
+                if (direction > 0 && strides[s] > max_covered_stride)
+                    max_covered_stride = strides[s];
+                if (direction < 0)
+                    backward_covered = 1;
+            }
+            printf("[Stride = %+-6ldB%s]\t latency %.1f cycles, coverage %.2f\n", stride,
+                   (unsigned long) strides[s] >= page_size ? " page-cross" : "           ", latency, coverage);
+            Record_Result("prefetch", "cycles", latency, "stride%+ld", stride);
+            Perf_Print(n * (PROBE_TRIALS / 4));
+        }
+    }
+
+    // 多路顺序流交替访问，每条流位于独立的区域。
+    // 各区域起点是 2 的幂的倍数，第 s 条流再错开 s 个 (页 + 行)，避免同一步的各流落在同一 Cache 组；
+    // 每一轮按随机顺序访问各流，相邻两次访问之间没有固定步长，只有逐流跟踪的预取器能覆盖
+    const unsigned long max_stream_count = 32;
+    unsigned long max_streams = 0, first_uncovered = 0;
+    unsigned long stream_order[32];
+    for (unsigned long streams = 1; streams <= max_stream_count; streams <<= 1) {
+        unsigned long stream_span = PREFETCH_REGION / streams;
+        for (unsigned long i = 0; i < PREFETCH_STEPS; i++) {
+            if (i % streams == 0)
+                Shuffle_Order(stream_order, streams);
+            unsigned long stream = stream_order[i % streams];
+            unsigned long skew = stream * (page_size + CACHE_LINE_SIZE);
+            offsets[i] = stream * stream_span + (skew + (i / streams) * CACHE_LINE_SIZE) % stream_span;
+        }
+        double latency = Time_Cold_Chain(buffer, offsets, PREFETCH_STEPS);
+        double coverage = Prefetch_Coverage(latency, t_random, t_hit);
+        // 取第一次覆盖不足之前的流数，之后即使偶然达标也不计入
+        if (coverage >= 0.5 && !first_uncovered)
+            max_streams = streams;
+        else if (!first_uncovered)
+            first_uncovered = streams;
+        printf("[Streams = %-3lu]\t latency %.1f cycles, coverage %.2f\n", streams, latency, coverage);
+        Record_Result("prefetch", "cycles", latency, "streams%lu", streams);
+        Perf_Print(PREFETCH_STEPS * (PROBE_TRIALS / 4));
+    }
+
+    // 软件预取距离扫描，沿用基准的随机顺序
+    for (unsigned long i = 0; i < PREFETCH_STEPS; i++)
+        offsets[i] = order[i] * CACHE_LINE_SIZE;
+    double t_no_prefetch = Time_Software_Prefetch(buffer, offsets, PREFETCH_STEPS, 0);
+    unsigned long best_distance = 0;
+    double best_latency = t_no_prefetch;
+    for (unsigned long distance = 1; distance <= 64; distance <<= 1) {
+        double latency = Time_Software_Prefetch(buffer, offsets, PREFETCH_STEPS, distance);
+        if (latency < best_latency) {
+            best_latency = latency;
+            best_distance = distance;
+        }
+        printf("[SW_Prefetch_Distance = %-2lu]\t latency %.1f cycles, speedup %.2fx\n",
+               distance, latency, t_no_prefetch / latency);
+        Record_Result("prefetch", "cycles", latency, "sw_distance%lu", distance);
+    }
+
+    // 总结
+    if (max_covered_stride)
+        printf("Prefetcher covers forward strides up to %ld B, backward strides %s\n",
+               max_covered_stride, backward_covered ? "covered" : "not covered");
+    else
+        printf("Prefetcher covers no tested stride\n");
+    if (!first_uncovered)
+        printf("Prefetcher tracks at least %lu concurrent streams\n", max_streams);
+    else if (max_streams)
+        printf("Prefetcher tracks %lu concurrent streams (first uncovered count: %lu)\n", max_streams, first_uncovered);
+    else
+        printf("Prefetcher covers no tested stream count\n");
+    printf("Best software prefetch distance: %lu accesses (%.2fx)\n", best_distance, t_no_prefetch / best_latency);
+
+    free(order);
+    free(offsets);
+    Free_Buffer(buffer, PREFETCH_REGION);
 }
 
 void Test_TLB_Size()
@@ -193,45 +1500,785 @@ void Test_TLB_Size()
     printf("**************************************************************\n");
     printf("TLB Size Test\n");
 
+    srand(TRACE_SEED);
+
     const int page_size = 1 << 12;								// Execute "getconf PAGE_SIZE" under linux terminal
 
     // 测试次数
     register unsigned long TLB_test_time = 1 << 15;
+    // 测试数组覆盖最多 2^9 个页面，一次分配供所有组复用
+    const unsigned long TLB_array_size = (unsigned long) page_size << 9;
+    BYTE* test_array = Alloc_Buffer(TLB_array_size);
     for (unsigned long group_size = (1 << 4); group_size < (1 << 9); group_size <<= 1) {
-        // 申请测试数组
-        BYTE* test_array = (BYTE*) malloc(ARRAY_SIZE);
         // 记录时间
         struct timeval tp[2];
         // 刷新L2Cache
-        Clear_L2_Cache();
+        Evict_Range(test_array, TLB_array_size);
 
         /*
          * 测试段
          */
+        Perf_Begin();
         gettimeofday(&tp[0], NULL);
         for (register unsigned long i = 0; i < TLB_test_time; i++) {
             register int index = (rand() % group_size) * page_size;
             test_array[index] = i;
         }
         gettimeofday(&tp[1], NULL);
+        Perf_End();
 
         // 输出结果
         printf("[Test_TLB_entries = %-5ld]\t Average access time: %3f us\n", group_size, get_usec(tp[0], tp[1]));
+        Record_Result("tlb_size", "us", get_usec(tp[0], tp[1]), "%ld", group_size);
+        Perf_Print(TLB_test_time);
+    }
+    Free_Buffer(test_array, TLB_array_size);
+}
+
+// 多级组相联 Cache 模拟器：按 Test_* 的访存序列回放，并与实测结果对照
+// 标签按组连续存放（set-major）：tags[set * assoc + way] = (tag << 2) | dirty | valid。
+// LRU 组内按最近使用顺序排列（第 0 路为 MRU），PLRU 每组一棵位树，随机替换用每级独立的 xorshift 状态，
+// 不消耗 rand()，以免打乱回放时按 TRACE_SEED 重建的访存序列
+#define SIM_MAX_LEVELS 4
+#define SIM_VALID 1ul
+#define SIM_DIRTY 2ul
+#define SIM_TAG_SHIFT 2
+#define SIM_BASE 0x10000000ul                                   // 回放时各测试数组的起始地址
+#define SIM_MEMORY_LATENCY 200                                  // 估算平均访存延迟时主存的名义延迟（周期）
+
+enum { SIM_LRU, SIM_PLRU, SIM_RANDOM };
+const char* sim_replace_names[] = { "lru", "plru", "random" };
+const double sim_latency[SIM_MAX_LEVELS] = { 4, 14, 50, 80 };   // 各级命中的名义延迟（周期）
+
+struct sim_level {
+    unsigned long size, assoc, line, sets;
+    int line_shift;
+    int replace, write_back, write_allocate;
+    unsigned long* tags;
+    unsigned long long* plru;
+    unsigned long long random_state;
+    unsigned long long accesses, misses, writebacks;
+};
+
+struct sim_level sim_levels[SIM_MAX_LEVELS];
+int sim_level_count = 0;
+int sim_enabled = 0;                                            // 由 -s/--simulate 打开
+const char* sim_spec = NULL;                                    // NULL 表示按本机几何参数配置
+
+int Sim_Add_Level(unsigned long size, unsigned long assoc, unsigned long line, int replace, int write_back, int write_allocate)
+{
+    if (sim_level_count == SIM_MAX_LEVELS || size == 0 || assoc == 0 || line == 0
+        || (line & (line - 1)) || size % (assoc * line)) {
+        printf("simulator: invalid level %lu B / %lu-way / %lu B line\n", size, assoc, line);
+        return 0;
+    }
+    if (replace == SIM_PLRU && ((assoc & (assoc - 1)) || assoc > 64)) {
+        printf("simulator: tree-PLRU needs a power-of-two associativity up to 64, using LRU for %lu-way\n", assoc);
+        replace = SIM_LRU;
+    }
+    struct sim_level* c = &sim_levels[sim_level_count++];
+    memset(c, 0, sizeof(*c));
+    c->size = size;
+    c->assoc = assoc;
+    c->line = line;
+    c->sets = size / (assoc * line);
+    while ((1ul << c->line_shift) < line)
+        c->line_shift++;
+    c->replace = replace;
+    c->write_back = write_back;
+    c->write_allocate = write_allocate;
+    c->tags = (unsigned long*) calloc(c->sets * assoc, sizeof(unsigned long));
+    if (replace == SIM_PLRU)
+        c->plru = (unsigned long long*) calloc(c->sets, sizeof(unsigned long long));
+    c->random_state = 0x9e3779b97f4a7c15ull + sim_level_count;
+    return 1;
+}
+
+// 解析形如 "32K:8:64:plru:wb,1M:16" 的配置，各级依次为 大小:路数[:行大小[:替换策略[:写策略]]]
+// 写策略为 wb（写回+写分配，默认）、wt（写直达+不分配）、wb-nwa 或 wt-wa
+int Sim_Parse(const char* spec)
+{
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", spec);
+    char* level_save;
+    for (char* level = strtok_r(copy, ",", &level_save); level; level = strtok_r(NULL, ",", &level_save)) {
+        char* fields[5] = { NULL, NULL, NULL, NULL, NULL };
+        char* field_save;
+        int n = 0;
+        for (char* f = strtok_r(level, ":", &field_save); f; f = strtok_r(NULL, ":", &field_save)) {
+            if (n == 5)
+                return 0;                                       // 多余的字段
+            fields[n++] = f;
+        }
+        if (n < 2)
+            return 0;
+        char* suffix;
+        unsigned long size = strtoul(fields[0], &suffix, 10);
+        if (*suffix == 'K' || *suffix == 'k')
+            size <<= 10;
+        else if (*suffix == 'M' || *suffix == 'm')
+            size <<= 20;
+        unsigned long assoc = strtoul(fields[1], NULL, 10);
+        unsigned long line = fields[2] ? strtoul(fields[2], NULL, 10) : CACHE_LINE_SIZE;
+        int replace = SIM_LRU;
+        if (fields[3] && strcmp(fields[3], "plru") == 0)
+            replace = SIM_PLRU;
+        else if (fields[3] && strcmp(fields[3], "random") == 0)
+            replace = SIM_RANDOM;
+        else if (fields[3] && strcmp(fields[3], "lru") != 0)
+            return 0;
+        const char* write = fields[4] ? fields[4] : "wb";
+        int write_back, write_allocate;
+        if (strcmp(write, "wb") == 0)
+            write_back = 1, write_allocate = 1;
+        else if (strcmp(write, "wt") == 0)
+            write_back = 0, write_allocate = 0;
+        else if (strcmp(write, "wb-nwa") == 0)
+            write_back = 1, write_allocate = 0;
+        else if (strcmp(write, "wt-wa") == 0)
+            write_back = 0, write_allocate = 1;
+        else
+            return 0;
+        if (!Sim_Add_Level(size, assoc, line, replace, write_back, write_allocate))
+            return 0;
+    }
+    return sim_level_count > 0;
+}
+
+// 未指定配置时按 sysconf 报告的本机 L1/L2/L3 建模
+void Sim_Config_Host()
+{
+    unsigned long size, assoc, line;
+    Detect_L1_Geometry(&size, &assoc, &line);
+    Sim_Add_Level(size, assoc, line, SIM_LRU, 1, 1);
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    const int names[2][3] = {
+        { _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL2_CACHE_ASSOC, _SC_LEVEL2_CACHE_LINESIZE },
+        { _SC_LEVEL3_CACHE_SIZE, _SC_LEVEL3_CACHE_ASSOC, _SC_LEVEL3_CACHE_LINESIZE }
+    };
+    for (int i = 0; i < 2; i++) {
+        long s = sysconf(names[i][0]), a = sysconf(names[i][1]), l = sysconf(names[i][2]);
+        if (s > 0 && a > 0 && l > 0)
+            Sim_Add_Level(s, a, l, SIM_LRU, 1, 1);
+    }
+#endif
+}
+
+// 刷出所有层级的内容，对应测试中的 Evict_Range
+void Sim_Flush()
+{
+    for (int i = 0; i < sim_level_count; i++) {
+        struct sim_level* c = &sim_levels[i];
+        memset(c->tags, 0, c->sets * c->assoc * sizeof(unsigned long));
+        if (c->plru)
+            memset(c->plru, 0, c->sets * sizeof(unsigned long long));
+    }
+}
+
+void Sim_Reset_Counters()
+{
+    for (int i = 0; i < sim_level_count; i++)
+        sim_levels[i].accesses = sim_levels[i].misses = sim_levels[i].writebacks = 0;
+}
+
+// 更新替换状态：LRU 把该路移到组首，PLRU 把路径上的位指向另一侧
+void Sim_Touch(struct sim_level* c, unsigned long* row, unsigned long set, unsigned long way)
+{
+    if (c->replace == SIM_LRU) {
+        unsigned long entry = row[way];
+        memmove(row + 1, row, way * sizeof(unsigned long));
+        row[0] = entry;
+        return;
+    }
+    if (c->replace == SIM_PLRU) {
+        unsigned long long tree = c->plru[set];
+        unsigned long node = 1;
+        for (unsigned long bit = c->assoc >> 1; bit; bit >>= 1) {
+            int right = (way & bit) != 0;
+            tree = right ? tree & ~(1ull << node) : tree | (1ull << node);
+            node = 2 * node + right;
+        }
+        c->plru[set] = tree;
+    }
+}
+
+// 选出替换路：优先空路，其次按策略
+unsigned long Sim_Victim(struct sim_level* c, unsigned long* row, unsigned long set)
+{
+    if (c->replace == SIM_LRU)
+        return c->assoc - 1;                                    // 空路总是排在组尾
+    for (unsigned long way = 0; way < c->assoc; way++)
+        if (!(row[way] & SIM_VALID))
+            return way;
+    if (c->replace == SIM_RANDOM) {
+        c->random_state ^= c->random_state << 13;
+        c->random_state ^= c->random_state >> 7;
+        c->random_state ^= c->random_state << 17;
+        return c->random_state % c->assoc;
+    }
+    unsigned long node = 1;
+    while (node < c->assoc)
+        node = 2 * node + ((c->plru[set] >> node) & 1);
+    return node - c->assoc;
+}
+
+// 从第 level 级开始访问 addr，返回命中的层级，全部缺失时返回 sim_level_count（主存）
+int Sim_Access_Level(int level, unsigned long addr, int write)
+{
+    if (level == sim_level_count)
+        return level;
+    struct sim_level* c = &sim_levels[level];
+    unsigned long line = addr >> c->line_shift;
+    unsigned long set = line % c->sets;
+    unsigned long tag = line / c->sets;
+    unsigned long* row = c->tags + set * c->assoc;
+    c->accesses++;
+
+    for (unsigned long way = 0; way < c->assoc; way++) {
+        if ((row[way] & SIM_VALID) && (row[way] >> SIM_TAG_SHIFT) == tag) {
+            if (write && c->write_back)
+                row[way] |= SIM_DIRTY;
+            else if (write)
+                Sim_Access_Level(level + 1, addr, 1);
+            Sim_Touch(c, row, set, way);
+            return level;
+        }
+    }
+
+    c->misses++;
+    if (write && !c->write_allocate)
+        return Sim_Access_Level(level + 1, addr, 1);
+    int served = Sim_Access_Level(level + 1, addr, 0);
+    unsigned long way = Sim_Victim(c, row, set);
+    if ((row[way] & SIM_VALID) && (row[way] & SIM_DIRTY)) {
+        c->writebacks++;
+        unsigned long victim = ((row[way] >> SIM_TAG_SHIFT) * c->sets + set) << c->line_shift;
+        Sim_Access_Level(level + 1, victim, 1);
+    }
+    row[way] = (tag << SIM_TAG_SHIFT) | SIM_VALID | (write && c->write_back ? SIM_DIRTY : 0);
+    if (write && !c->write_back)
+        Sim_Access_Level(level + 1, addr, 1);
+    Sim_Touch(c, row, set, way);
+    return served;
+}
+
+// 一次访存的平均延迟估算
+double sim_cycles = 0;
+unsigned long long sim_accesses = 0;
+
+static inline double Sim_Latency(int level)
+{
+    return level < sim_level_count ? sim_latency[level] : SIM_MEMORY_LATENCY;
+}
+
+static inline void Sim_Access(unsigned long addr, int write)
+{
+    sim_cycles += Sim_Latency(Sim_Access_Level(0, addr, write));
+    sim_accesses++;
+}
+
+// 每个测试点的 (实测, 模拟) 数据对，用于计算相关系数
+double sim_measured[64], sim_predicted[64];
+int sim_points = 0;
+const char* sim_test = "";
 
-        free(test_array);
+void Sim_Test_Begin(const char* test)
+{
+    printf("**************************************************************\n");
+    printf("Simulated %s\n", test);
+    sim_test = test;
+    sim_points = 0;
+}
+
+// 结束一个测试点：输出各级缺失率与估算延迟，并与本次运行记录的实测中位数对照
+void Sim_Point(const char* point_fmt, ...)
+{
+    char point[48];
+    va_list args;
+    va_start(args, point_fmt);
+    vsnprintf(point, sizeof(point), point_fmt, args);
+    va_end(args);
+
+    double amat = sim_cycles / sim_accesses;
+    double measured = -1;
+    const char* unit = "";
+    for (int i = 0; i < result_count; i++) {
+        if (strcmp(results[i].test, sim_test) == 0 && strcmp(results[i].point, point) == 0) {
+            measured = results[i].median;
+            unit = results[i].unit;
+        }
+    }
+
+    printf("[%s %-6s]\t", sim_test, point);
+    for (int i = 0; i < sim_level_count; i++)
+        printf(" L%d miss %.3f", i + 1, (double) sim_levels[i].misses / sim_accesses);
+    printf(", est. %.1f cycles/access", amat);
+    if (measured >= 0)
+        printf(", measured %.3f %s", measured, unit);
+    printf("\n");
+    if (measured >= 0 && sim_points < 64) {
+        sim_measured[sim_points] = measured;
+        sim_predicted[sim_points] = amat;
+        sim_points++;
+    }
+
+    Sim_Reset_Counters();
+    sim_cycles = 0;
+    sim_accesses = 0;
+}
+
+// 输出实测曲线与模拟曲线的 Pearson 相关系数
+void Sim_Test_End()
+{
+    if (sim_points < 2) {
+        printf("No measured points to compare against\n");
+        return;
     }
+    double mx = 0, my = 0, sxy = 0, sxx = 0, syy = 0;
+    for (int i = 0; i < sim_points; i++) {
+        mx += sim_measured[i];
+        my += sim_predicted[i];
+    }
+    mx /= sim_points;
+    my /= sim_points;
+    for (int i = 0; i < sim_points; i++) {
+        sxy += (sim_measured[i] - mx) * (sim_predicted[i] - my);
+        sxx += (sim_measured[i] - mx) * (sim_measured[i] - mx);
+        syy += (sim_predicted[i] - my) * (sim_predicted[i] - my);
+    }
+    if (sxx == 0 || syy == 0)
+        printf("Correlation measured vs simulated: undefined (flat curve)\n");
+    else
+        printf("Correlation measured vs simulated: %.3f\n", sxy / sqrt(sxx * syy));
+}
+
+// 以下各函数按对应 Test_* 的循环逐一生成相同的地址序列（数组起始地址换成 SIM_BASE 起的页对齐地址）
+void Sim_Replay_Cache_Size()
+{
+    Sim_Test_Begin("cache_size");
+    srand(TRACE_SEED);
+    for (int offset = 10; offset < 20; offset++) {
+        unsigned long bound = 1 << offset;
+        unsigned long mod = bound >> 2;
+        unsigned long span = (mod + 4095) & ~4095ul;
+        Sim_Flush();
+        for (unsigned long i = 0; i < 1 << 15; i++) {
+            unsigned long index = rand() % mod;
+            for (int part = 0; part < 4; part++)
+                Sim_Access(SIM_BASE + part * span + index, 1);
+        }
+        Sim_Point("%ldKB", bound >> 10);
+    }
+    Sim_Test_End();
+}
+
+void Sim_Replay_L1C_Block_Size()
+{
+    Sim_Test_Begin("l1_block_size");
+    const unsigned long block_test_time = 1 << 15;
+    const unsigned long block_array_size = block_test_time << 9;
+    for (unsigned long offset = 4; offset < 10; offset++) {
+        unsigned long jump = 1u << offset;
+        unsigned long index = 0;
+        Sim_Flush();
+        for (unsigned long i = 0; i < block_test_time; i++) {
+            Sim_Access(SIM_BASE + index, 1);
+            index = (index + jump) % block_array_size;
+        }
+        Sim_Point("%ldB", jump);
+    }
+    Sim_Test_End();
+}
+
+void Sim_Replay_L1C_Way_Count()
+{
+    Sim_Test_Begin("l1_way_count");
+    unsigned long cache_size = 1 << 15;
+    unsigned long way_count_test_time = 1 << 20;
+    for (unsigned long group_size = (1 << 2); group_size < (1 << 8); group_size <<= 1) {
+        unsigned long group_max_index = (cache_size << 1) / group_size;
+        Sim_Flush();
+        unsigned long cnt = 0;
+        while (cnt < way_count_test_time) {
+            for (unsigned long group_index = 1; group_index < group_max_index; group_index += 2) {
+                for (unsigned long offset = 0; offset < group_size; offset++) {
+                    Sim_Access(SIM_BASE + group_index * group_size + offset, 1);
+                    cnt++;
+                }
+            }
+        }
+        Sim_Point("%ld", group_size);
+    }
+    Sim_Test_End();
+}
+
+// TLB 不在模拟范围内，这里只反映该访存序列的 Cache 行为
+void Sim_Replay_TLB_Size()
+{
+    Sim_Test_Begin("tlb_size");
+    const int page_size = 1 << 12;
+    srand(TRACE_SEED);
+    for (unsigned long group_size = (1 << 4); group_size < (1 << 9); group_size <<= 1) {
+        Sim_Flush();
+        for (unsigned long i = 0; i < 1 << 15; i++)
+            Sim_Access(SIM_BASE + (rand() % group_size) * page_size, 1);
+        Sim_Point("%ld", group_size);
+    }
+    Sim_Test_End();
+}
+
+// 以下回放各策略探测的访存序列，用模拟结果代替计时，交给探测所用的同一判定函数，
+// 检查探测能否在已知替换/写策略的配置上给出正确结论。expected 为 NULL 表示该配置没有唯一的预期结论
+void Sim_Verdict(const char* probe, const char* policy, double score, const char* configured, const char* expected)
+{
+    printf("[%s]\t classified %s, confidence: %s (%.2f), configured %s", probe, policy,
+           Confidence_Level(score), score, configured);
+    if (expected)
+        printf(", %s\n", strcmp(policy, expected) == 0 ? "match" : "MISMATCH");
+    else
+        printf("\n");
+}
+
+// 沿 order 给出的行序走 steps 步（每行一次依赖读），返回估算的每步延迟
+double Sim_Chase(unsigned long base, const unsigned long* order, unsigned long n, unsigned long steps)
+{
+    double cycles = 0;
+    for (unsigned long i = 0; i < steps; i++)
+        cycles += Sim_Latency(Sim_Access_Level(0, base + order[i % n] * CACHE_LINE_SIZE, 0));
+    return cycles / steps;
+}
+
+// 写带宽估算：按各级实际收到的访问（含写直达与写回）累计名义延迟，再均摊到每次访问
+double Sim_Traffic(unsigned long accesses)
+{
+    double cycles = 0;
+    for (int i = 0; i < sim_level_count; i++)
+        cycles += sim_levels[i].accesses * sim_latency[i];
+    struct sim_level* last = &sim_levels[sim_level_count - 1];
+    cycles += (last->misses + last->writebacks) * (double) SIM_MEMORY_LATENCY;
+    Sim_Reset_Counters();
+    return cycles / accesses;
 }
 
-int main()
+void Sim_Replay_L1_Replacement()
+{
+    Sim_Test_Begin("l1_replacement");
+    struct sim_level* c = &sim_levels[0];
+    const unsigned long ways = c->assoc;
+    const unsigned long way_stride = c->size / c->assoc;
+    const unsigned long set_offset = 37 * CACHE_LINE_SIZE;
+    if (ways < 2 || way_stride < 64 * CACHE_LINE_SIZE) {
+        printf("[l1_replacement]\t unsupported L1 geometry, skipped\n");
+        return;
+    }
+    const unsigned long lines = 4 * ways + 1;
+#define LINE(k) (SIM_BASE + set_offset + (k) * way_stride)
+    double miss_rate[ways];
+    for (unsigned long victim = 0; victim < ways; victim++) {
+        int misses = 0;
+        for (int t = 0; t < 4 * PROBE_TRIALS; t++) {
+            for (unsigned long k = ways + 1; k < lines; k++)
+                Sim_Access_Level(0, LINE(k), 0);
+            for (unsigned long k = 0; k < ways; k++)
+                Sim_Access_Level(0, LINE(k), 0);
+            Sim_Access_Level(0, LINE(0), 0);
+            Sim_Access_Level(0, LINE(ways), 0);
+            if (Sim_Access_Level(0, LINE(victim), 0) > 0)
+                misses++;
+        }
+        miss_rate[victim] = (double) misses / (4 * PROBE_TRIALS);
+    }
+#undef LINE
+    Sim_Reset_Counters();
+    unsigned long top;
+    double others, score;
+    const char* policy = Classify_L1_Replacement(miss_rate, ways, &top, &others, &score);
+    printf("[l1_replacement]\t victim way %lu (%.2f), others %.2f\n", top, miss_rate[top], others);
+    const char* expected[] = { "LRU", "tree-PLRU", "random" };
+    Sim_Verdict("l1_replacement", policy, score, sim_replace_names[c->replace], expected[c->replace]);
+}
+
+// 与 Test_Cache_Swap_Method 相同地选择被探测的层级：末级放不进探测缓冲区时退而回放 L2
+void Sim_Replay_LLC_Replacement()
+{
+    Sim_Test_Begin("llc_replacement");
+    int level = sim_level_count - 1;
+    if (level > 1 && sim_levels[level].size + (sim_levels[level].size >> 1) > PROBE_MAX_SIZE)
+        level = 1;
+    struct sim_level* c = &sim_levels[level];
+    const unsigned long llc_size = c->size;
+    const unsigned long hot_size = llc_size >> 1;
+    const unsigned long buffer_size = hot_size + llc_size;
+    if (level == 0 || buffer_size > PROBE_MAX_SIZE) {
+        printf("[llc_replacement]\t no outer level that fits the probe buffer, skipped\n");
+        return;
+    }
+    const unsigned long hot_steps = hot_size / CACHE_LINE_SIZE;
+    const unsigned long thrash_steps = (llc_size + (llc_size >> 2)) / CACHE_LINE_SIZE;
+    const unsigned long scan_steps = llc_size / CACHE_LINE_SIZE;
+    // 与 Probe_LLC_Replacement 按相同顺序以 TRACE_SEED 生成三个环
+    unsigned long* hot = (unsigned long*) malloc(hot_steps * sizeof(unsigned long));
+    unsigned long* thrash = (unsigned long*) malloc(thrash_steps * sizeof(unsigned long));
+    unsigned long* scan = (unsigned long*) malloc(scan_steps * sizeof(unsigned long));
+    srand(TRACE_SEED);
+    Shuffle_Order(hot, hot_steps);
+    Shuffle_Order(thrash, thrash_steps);
+    Shuffle_Order(scan, scan_steps);
+    const unsigned long scan_base = SIM_BASE + hot_size;
+
+    Sim_Flush();
+    Sim_Chase(SIM_BASE, hot, hot_steps, hot_steps);
+    double t_hit = Sim_Chase(SIM_BASE, hot, hot_steps, hot_steps);
+    Sim_Flush();
+    if (level < sim_level_count - 1) {
+        Sim_Chase(SIM_BASE, hot, hot_steps, hot_steps);
+        Sim_Chase(scan_base, scan, scan_steps, 2 * scan_steps);
+    }
+    double t_miss = Sim_Chase(SIM_BASE, hot, hot_steps, hot_steps);
+
+    Sim_Flush();
+    Sim_Chase(SIM_BASE, thrash, thrash_steps, 3 * thrash_steps);
+    double t_cyclic = Sim_Chase(SIM_BASE, thrash, thrash_steps, thrash_steps);
+
+    Sim_Chase(SIM_BASE, hot, hot_steps, 2 * hot_steps);
+    for (unsigned long i = hot_size; i < buffer_size; i += CACHE_LINE_SIZE)
+        Sim_Access_Level(0, SIM_BASE + i, 0);
+    double t_after_scan = Sim_Chase(SIM_BASE, hot, hot_steps, hot_steps);
+    Sim_Reset_Counters();
+    free(hot);
+    free(thrash);
+    free(scan);
+
+    double retained, hot_kept, score;
+    const char* policy = Classify_LLC_Replacement(t_hit, t_miss, t_cyclic, t_after_scan, &retained, &hot_kept, &score);
+    printf("[llc_replacement]\t L%d: hit %.0f / miss %.0f / cyclic %.0f / after scan %.0f cycles, "
+           "retained %.2f, hot kept %.2f\n", level + 1, t_hit, t_miss, t_cyclic, t_after_scan, retained, hot_kept);
+    // 树形 PLRU 在两种模式下的表现取决于组内状态，不给预期结论
+    const char* expected[] = { "LRU-like", NULL, "random" };
+    Sim_Verdict("llc_replacement", policy, score, sim_replace_names[c->replace], expected[c->replace]);
+}
+
+void Sim_Replay_Write_Policy()
+{
+    Sim_Test_Begin("write_policy");
+    struct sim_level* c = &sim_levels[0];
+    const char* configured = c->write_back ? (c->write_allocate ? "wb" : "wb-nwa") : (c->write_allocate ? "wt-wa" : "wt");
+    double score;
+
+    // 写命中：与 Probe_Write_Hit_Policy 相同的规模与顺序，取稳态下一次试验
+    if (sim_level_count > 1) {
+        const unsigned long small_size = c->size >> 1, large_size = c->size << 3;
+        const unsigned long small_lines = small_size / CACHE_LINE_SIZE, large_lines = large_size / CACHE_LINE_SIZE;
+        unsigned long* small_ring = (unsigned long*) malloc(small_lines * sizeof(unsigned long));
+        unsigned long* large_ring = (unsigned long*) malloc(large_lines * sizeof(unsigned long));
+        srand(TRACE_SEED);
+        Shuffle_Order(small_ring, small_lines);
+        Shuffle_Order(large_ring, large_lines);
+        double store_small = 0, store_large = 0, load_small = 0, load_large = 0;
+        Sim_Flush();
+        for (int t = 0; t < 2; t++) {
+            for (int round = 0; round < 1 + 16; round++) {
+                if (round == 1)
+                    Sim_Reset_Counters();                       // 第一轮为预热
+                for (unsigned long i = 0; i < small_size; i += CACHE_LINE_SIZE)
+                    Sim_Access_Level(0, SIM_BASE + i, 1);
+            }
+            store_small = Sim_Traffic(16 * small_lines);
+            for (int round = 0; round < 2; round++)
+                for (unsigned long i = 0; i < large_size; i += CACHE_LINE_SIZE)
+                    Sim_Access_Level(0, SIM_BASE + i, 1);
+            store_large = Sim_Traffic(2 * large_lines);
+            Sim_Chase(SIM_BASE, small_ring, small_lines, small_lines);
+            load_small = Sim_Chase(SIM_BASE, small_ring, small_lines, 16 * small_lines);
+            load_large = Sim_Chase(SIM_BASE, large_ring, large_lines, 2 * large_lines);
+        }
+        Sim_Reset_Counters();
+        free(small_ring);
+        free(large_ring);
+        double store_ratio = store_large / store_small, load_ratio = load_large / load_small;
+        const char* policy = Classify_Write_Hit(store_ratio, load_ratio, &score);
+        printf("[write_hit_policy]\t store L2/L1 = %.2f, load L2/L1 = %.2f\n", store_ratio, load_ratio);
+        Sim_Verdict("write_hit_policy", policy, score, configured, c->write_back ? "write-back" : "write-through");
+    }
+
+    // 写缺失：与 Probe_Write_Miss_Policy 相同的跨页行序列
+    const unsigned long stride = 4096 + CACHE_LINE_SIZE;
+    const unsigned long lines = 64;
+    double cycles = 0;
+    Sim_Flush();
+    for (unsigned long i = 0; i < lines; i++)
+        cycles += Sim_Latency(Sim_Access_Level(0, SIM_BASE + i * stride, 0));
+    double t_miss = cycles / lines;
+    cycles = 0;
+    for (unsigned long i = 0; i < lines; i++)
+        cycles += Sim_Latency(Sim_Access_Level(0, SIM_BASE + i * stride, 0));
+    double t_hit = cycles / lines;
+    Sim_Flush();
+    for (unsigned long i = 0; i < lines; i++)
+        Sim_Access_Level(0, SIM_BASE + i * stride, 1);
+    cycles = 0;
+    for (unsigned long i = 0; i < lines; i++)
+        cycles += Sim_Latency(Sim_Access_Level(0, SIM_BASE + i * stride, 0));
+    double t_store_load = cycles / lines;
+    Sim_Reset_Counters();
+    const char* policy = Classify_Write_Miss(t_hit, t_miss, t_store_load, &score);
+    printf("[write_miss_policy]\t hit %.1f / miss %.1f / store-then-load %.1f cycles\n", t_hit, t_miss, t_store_load);
+    Sim_Verdict("write_miss_policy", policy, score, configured, c->write_allocate ? "write-allocate" : "no-write-allocate");
+}
+
+void Simulate_Tests()
+{
+    if (sim_spec ? !Sim_Parse(sim_spec) : (Sim_Config_Host(), sim_level_count == 0)) {
+        printf("simulator: cannot configure cache levels from \"%s\"\n", sim_spec ? sim_spec : "host");
+        return;
+    }
+    printf("**************************************************************\n");
+    printf("Cache Simulator Configuration\n");
+    for (int i = 0; i < sim_level_count; i++) {
+        struct sim_level* c = &sim_levels[i];
+        printf("[L%d]\t %lu KB, %lu-way, %lu B line, %lu sets, %s, %s, %s\n", i + 1, c->size >> 10, c->assoc,
+               c->line, c->sets, sim_replace_names[c->replace], c->write_back ? "write-back" : "write-through",
+               c->write_allocate ? "write-allocate" : "no-write-allocate");
+    }
+
+    Sim_Replay_Cache_Size();
+    Sim_Replay_L1C_Block_Size();
+    Sim_Replay_L1C_Way_Count();
+    Sim_Replay_TLB_Size();
+    Sim_Replay_L1_Replacement();
+    Sim_Replay_LLC_Replacement();
+    Sim_Replay_Write_Policy();
+
+    for (int i = 0; i < sim_level_count; i++) {
+        free(sim_levels[i].tags);
+        free(sim_levels[i].plru);
+    }
+}
+
+void Run_Tests()
 {
     Test_Cache_Size();
     Test_L1C_Block_Size();
     // Test_L2C_Block_Size();
     Test_L1C_Way_Count();
     // Test_L2C_Way_Count();
-    // Test_Cache_Write_Policy();
-    // Test_Cache_Swap_Method();
+    Test_Cache_Write_Policy();
+    Test_Cache_Swap_Method();
+    Test_Prefetcher();
     Test_TLB_Size();
+}
 
-    return 0;
+void Usage(const char* program)
+{
+    printf("Usage: %s [-p] [-n repeats] [-f text|json|csv] [-o file] [-c baseline] [-s[spec]]\n", program);
+    printf("  -p, --perf              report perf_event_open counters next to each timing\n");
+    printf("  -n, --repeat N          run the suite N times (max %d) and report median/min/stddev\n", MAX_REPEATS);
+    printf("  -f, --format FMT        summary format: text (default), json or csv\n");
+    printf("  -o, --output FILE       write the summary to FILE instead of stdout\n");
+    printf("  -c, --compare BASELINE  compare against a saved json/csv summary, exit 2 on regressions,\n"
+           "                          3 if no point had enough repetitions to compare\n");
+    printf("  -s, --simulate[=SPEC]   replay each test's address trace through a cache simulator and compare\n");
+    printf("                          with the measurements; SPEC is size:assoc[:line[:lru|plru|random[:wb|wt|wb-nwa|wt-wa]]]\n");
+    printf("                          per level, comma separated (default: host L1/L2/L3, LRU, write-back)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const struct option long_options[] = {
+        { "perf", no_argument, NULL, 'p' },
+        { "repeat", required_argument, NULL, 'n' },
+        { "format", required_argument, NULL, 'f' },
+        { "output", required_argument, NULL, 'o' },
+        { "compare", required_argument, NULL, 'c' },
+        { "simulate", optional_argument, NULL, 's' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int repeats = 1;
+    const char* format = "text";
+    const char* output = NULL;
+    const char* baseline = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "pn:f:o:c:s::h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'p':
+            perf_enabled = 1;
+            break;
+        case 'n':
+            repeats = atoi(optarg);
+            break;
+        case 'f':
+            format = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'c':
+            baseline = optarg;
+            break;
+        case 's':
+            sim_enabled = 1;
+            sim_spec = optarg;
+            break;
+        case 'h':
+            Usage(argv[0]);
+            return 0;
+        default:
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    if (repeats < 1 || repeats > MAX_REPEATS
+        || (strcmp(format, "text") && strcmp(format, "json") && strcmp(format, "csv"))) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    // 结构化结果写到 stdout 时，把测试过程的输出改到 stderr
+    FILE* result_fp = stdout;
+    if (output != NULL) {
+        result_fp = fopen(output, "w");
+        if (result_fp == NULL) {
+            perror(output);
+            return 1;
+        }
+    } else if (strcmp(format, "text") != 0) {
+        result_fp = fdopen(dup(STDOUT_FILENO), "w");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    Evict_Init();
+    Perf_Init();
+
+    for (current_repeat = 0; current_repeat < repeats; ) {
+        if (repeats > 1)
+            printf("======================== Repetition %d/%d ========================\n", current_repeat + 1, repeats);
+        Run_Tests();
+        current_repeat++;
+    }
+
+    for (int i = 0; i < result_count; i++)
+        Result_Stats(&results[i]);
+    if (strcmp(format, "json") == 0)
+        Write_Results_Json(result_fp);
+    else if (strcmp(format, "csv") == 0)
+        Write_Results_Csv(result_fp);
+    else if (repeats > 1 || output != NULL)
+        Write_Results_Text(result_fp);
+    fflush(result_fp);
+    if (result_fp != stdout)
+        fclose(result_fp);
+
+    if (sim_enabled)
+        Simulate_Tests();
+
+    int status = 0;
+    if (baseline != NULL) {
+        int regressions = Compare_Baseline(baseline);
+        status = regressions == -2 ? 3 : regressions < 0 ? 1 : regressions > 0 ? 2 : 0;
+    }
+
+    if (evict_buffer != NULL)
+        Free_Buffer(evict_buffer, evict_mapped);
+    return status;
 }